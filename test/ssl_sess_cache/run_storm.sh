@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Reconnect storm test for zk_ssl_sess_cache and the zymkey OpenSSL provider.
+# No Zymkey is needed: zk_app_utils_stub.c stands in for libzk_app_utils and
+# counts the signatures the module would have generated.
+#
+# For each server configuration, 16 threads x 3 rounds of connections are
+# made to a local openssl s_server that requires a client certificate. With
+# the cache, all 48 connections must get by with a single signature: the
+# first full handshake of round 0 coalesces the others and every later
+# connection resumes.
+#
+# Requires a C compiler, the OpenSSL 3 headers and the openssl command.
+#
+# Usage: ./run_storm.sh [port]    (default port 44330)
+
+set -e
+
+port=${1:-44330}
+src=$(cd "$(dirname "$0")" && pwd)
+top=$(cd "${src}/../.." && pwd)
+work=$(mktemp -d)
+server=""
+
+cleanup()
+{
+  if [ -n "${server}" ]; then kill "${server}" 2>/dev/null; wait "${server}" 2>/dev/null; fi
+  rm -rf "${work}"
+}
+trap cleanup EXIT
+
+cd "${work}"
+
+# Test PKI: a CA, a server certificate and the client key that "lives in the
+# Zymkey", with its certificate.
+openssl req -x509 -new -nodes -newkey ec -pkeyopt ec_paramgen_curve:P-256 \
+  -keyout ca.key -out ca.pem -subj /CN=test-ca -days 1 2>/dev/null
+openssl req -new -nodes -newkey ec -pkeyopt ec_paramgen_curve:P-256 \
+  -keyout srv.key -out srv.csr -subj /CN=localhost 2>/dev/null
+openssl x509 -req -in srv.csr -CA ca.pem -CAkey ca.key -CAcreateserial \
+  -out srv.pem -days 1 2>/dev/null
+openssl req -new -nodes -newkey ec -pkeyopt ec_paramgen_curve:P-256 \
+  -keyout zk.key -out client.csr -subj /CN=zymkey-client 2>/dev/null
+openssl x509 -req -in client.csr -CA ca.pem -CAkey ca.key -CAcreateserial \
+  -out client.pem -days 1 2>/dev/null
+
+# The stub is built as libzk_app_utils.so so that the provider links exactly
+# as documented in zk_ossl_provider.c.
+CFLAGS="-std=c99 -O2 -Wall -Wextra -Werror -I${top}"
+cc ${CFLAGS} -shared -fPIC -o libzk_app_utils.so "${src}/zk_app_utils_stub.c" -lcrypto -lpthread
+cc ${CFLAGS} -shared -fPIC -o zymkey.so "${top}/zk_ossl_provider.c" \
+  -L. -Wl,-rpath,"${work}" -lzk_app_utils -lcrypto -lpthread
+cc ${CFLAGS} -o zk_sess_storm "${src}/zk_sess_storm.c" "${top}/zk_ssl_sess_cache.c" \
+  -L. -Wl,-rpath,"${work}" -lzk_app_utils -lssl -lcrypto -lpthread
+
+export OPENSSL_MODULES="${work}"
+export ZK_STUB_KEY="${work}/zk.key"
+
+status=0
+run()
+{
+  local name=$1 client_opt=$2
+  shift 2
+  openssl s_server -accept "${port}" -cert srv.pem -key srv.key -CAfile ca.pem \
+    -Verify 1 -www -quiet "$@" >/dev/null 2>&1 &
+  server=$!
+  sleep 1
+  echo "== ${name}"
+  out=$(./zk_sess_storm "localhost:${port}" client.pem ca.pem 16 3 ${client_opt}) || status=1
+  echo "${out}"
+  kill "${server}" 2>/dev/null || true; wait "${server}" 2>/dev/null || true
+  server=""
+  if ! echo "${out}" | grep -q "signatures=1$"; then
+    echo "FAIL: expected a single signature"
+    status=1
+  fi
+}
+
+run "TLS 1.3, stateless tickets" ""
+run "TLS 1.3, stateful tickets" "" -no_ticket
+run "TLS 1.2, session IDs" "1.2"
+
+exit ${status}
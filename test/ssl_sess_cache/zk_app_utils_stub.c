@@ -0,0 +1,144 @@
+/**
+ * @file zk_app_utils_stub.c
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief Software key stand-in for libzk_app_utils, for testing without a
+ *        Zymkey.
+ * @details
+ * Implements the functions used by zk_ossl_provider.c with a P-256 private
+ * key read from the PEM file named by the ZK_STUB_KEY environment variable.
+ * Every slot maps to that key. Built as libzk_app_utils.so, it lets the
+ * provider and zk_sess_storm run unchanged, and zkStubSignCount reports how
+ * many signatures "the module" produced.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#include "zk_app_utils.h"
+
+#define ZK_STUB_COORD_SZ        32
+
+static pthread_mutex_t zkStubLock = PTHREAD_MUTEX_INITIALIZER;
+static EVP_PKEY* zkStubKey;
+static int zkStubSigns;
+
+/**
+ * @brief Get the number of signatures generated since the library was loaded.
+ */
+int zkStubSignCount(void);
+
+static EVP_PKEY* zkStubGetKey(void)
+{
+    const char* path;
+    FILE* f;
+
+    pthread_mutex_lock(&zkStubLock);
+    if (!zkStubKey && (path = getenv("ZK_STUB_KEY")) && (f = fopen(path, "r")))
+    {
+        zkStubKey = PEM_read_PrivateKey(f, NULL, NULL, NULL);
+        fclose(f);
+    }
+    pthread_mutex_unlock(&zkStubLock);
+    return zkStubKey;
+}
+
+int zkOpen(zkCTX* ctx)
+{
+    if (!ctx || !zkStubGetKey())
+    {
+        return -ENODEV;
+    }
+    *ctx = (zkCTX)zkStubGetKey();
+    return 0;
+}
+
+int zkClose(zkCTX ctx)
+{
+    (void)ctx;
+    return 0;
+}
+
+int zkGetECDSAPubKey(zkCTX ctx, uint8_t** pk, int* pk_sz, int slot)
+{
+    uint8_t pt[1 + 2 * ZK_STUB_COORD_SZ];
+    size_t pt_sz = 0;
+
+    (void)slot;
+    if (!EVP_PKEY_get_octet_string_param((EVP_PKEY*)ctx, OSSL_PKEY_PARAM_PUB_KEY,
+                                         pt, sizeof(pt), &pt_sz) ||
+        pt_sz != sizeof(pt))
+    {
+        return -EINVAL;
+    }
+    // The module returns X || Y without the uncompressed point prefix.
+    *pk = malloc(pt_sz - 1);
+    if (!*pk)
+    {
+        return -ENOMEM;
+    }
+    memcpy(*pk, pt + 1, pt_sz - 1);
+    *pk_sz = (int)(pt_sz - 1);
+    return 0;
+}
+
+int zkGenECDSASigFromDigest(zkCTX ctx,
+                            const uint8_t* digest,
+                            int slot,
+                            uint8_t** sig,
+                            int* sig_sz)
+{
+    EVP_PKEY_CTX* pctx;
+    ECDSA_SIG* esig = NULL;
+    unsigned char der[80];
+    const unsigned char* p = der;
+    size_t der_sz = sizeof(der);
+    int ok;
+
+    (void)slot;
+    pctx = EVP_PKEY_CTX_new_from_pkey(NULL, (EVP_PKEY*)ctx, "provider=default");
+    ok = pctx && EVP_PKEY_sign_init(pctx) > 0 &&
+         EVP_PKEY_sign(pctx, der, &der_sz, digest, ZK_STUB_COORD_SZ) > 0 &&
+         (esig = d2i_ECDSA_SIG(NULL, &p, (long)der_sz)) != NULL;
+    EVP_PKEY_CTX_free(pctx);
+    if (!ok)
+    {
+        return -EIO;
+    }
+
+    // The module returns r || s.
+    *sig = malloc(2 * ZK_STUB_COORD_SZ);
+    if (!*sig)
+    {
+        ECDSA_SIG_free(esig);
+        return -ENOMEM;
+    }
+    BN_bn2binpad(ECDSA_SIG_get0_r(esig), *sig, ZK_STUB_COORD_SZ);
+    BN_bn2binpad(ECDSA_SIG_get0_s(esig), *sig + ZK_STUB_COORD_SZ, ZK_STUB_COORD_SZ);
+    ECDSA_SIG_free(esig);
+    *sig_sz = 2 * ZK_STUB_COORD_SZ;
+
+    pthread_mutex_lock(&zkStubLock);
+    zkStubSigns++;
+    pthread_mutex_unlock(&zkStubLock);
+    return 0;
+}
+
+int zkStubSignCount(void)
+{
+    int n;
+
+    pthread_mutex_lock(&zkStubLock);
+    n = zkStubSigns;
+    pthread_mutex_unlock(&zkStubLock);
+    return n;
+}
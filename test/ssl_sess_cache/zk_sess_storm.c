@@ -0,0 +1,166 @@
+/**
+ * @file zk_sess_storm.c
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief Reconnect storm driver for zk_ssl_sess_cache.
+ * @details
+ * Simulates an application that reconnects all of its TLS connections at
+ * once after a network outage. Each round starts one thread per connection;
+ * every thread calls zkSessCacheBegin, connects, performs the handshake with
+ * the client key in the Zymkey (through the zymkey provider), reports the
+ * outcome with zkSessCacheEnd, and reads an HTTP response, which also
+ * collects the server's TLS 1.3 tickets.
+ *
+ * Usage:
+ *
+ *     zk_sess_storm <host:port> <cert.pem> <ca.pem> <threads> <rounds> [1.2]
+ *
+ * The zymkey provider is loaded from OPENSSL_MODULES. When built against
+ * zk_app_utils_stub.c, the number of signatures the module generated is
+ * printed at the end. See run_storm.sh.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/err.h>
+#include <openssl/provider.h>
+#include <openssl/ssl.h>
+#include <openssl/store.h>
+
+#include "zk_ssl_sess_cache.h"
+
+#define ZK_STORM_MAX_THREADS    256
+#define ZK_STORM_WAIT_MS        5000
+
+int zkStubSignCount(void);
+
+static SSL_CTX* sslCtx;
+static zkSessCache* sessCache;
+static const char* peer;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static int numFull;
+static int numResumed;
+static int numFailed;
+
+static void* stormConn(void* arg)
+{
+    SSL* ssl;
+    BIO* bio;
+    char buf[4096];
+    int* stat = &numFailed;
+    bool ok = false;
+
+    (void)arg;
+    ssl = SSL_new(sslCtx);
+    if (ssl && zkSessCacheBegin(sessCache, ssl, peer) >= 0 &&
+        (bio = BIO_new_connect(peer)))
+    {
+        SSL_set_bio(ssl, bio, bio);
+        ok = SSL_connect(ssl) == 1;
+        zkSessCacheEnd(sessCache, ssl, ok);
+    }
+    if (ok && SSL_write(ssl, "GET / HTTP/1.0\r\n\r\n", 18) > 0)
+    {
+        while (SSL_read(ssl, buf, sizeof(buf)) > 0)
+        {
+        }
+        stat = SSL_session_reused(ssl) ? &numResumed : &numFull;
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+
+    pthread_mutex_lock(&statsLock);
+    (*stat)++;
+    pthread_mutex_unlock(&statsLock);
+    return NULL;
+}
+
+static EVP_PKEY* loadZkKey(const char* uri)
+{
+    OSSL_STORE_CTX* store;
+    OSSL_STORE_INFO* info;
+    EVP_PKEY* pkey = NULL;
+
+    store = OSSL_STORE_open(uri, NULL, NULL, NULL, NULL);
+    if (!store)
+    {
+        return NULL;
+    }
+    while (!pkey && (info = OSSL_STORE_load(store)))
+    {
+        pkey = OSSL_STORE_INFO_get1_PKEY(info);
+        OSSL_STORE_INFO_free(info);
+    }
+    OSSL_STORE_close(store);
+    return pkey;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t threads[ZK_STORM_MAX_THREADS];
+    EVP_PKEY* pkey;
+    int num_threads;
+    int num_rounds;
+    int round;
+    int i;
+
+    if (argc < 6 || (num_threads = atoi(argv[4])) < 1 ||
+        num_threads > ZK_STORM_MAX_THREADS || (num_rounds = atoi(argv[5])) < 1)
+    {
+        fprintf(stderr, "usage: %s <host:port> <cert.pem> <ca.pem> "
+                        "<threads> <rounds> [1.2]\n", argv[0]);
+        return 2;
+    }
+    peer = argv[1];
+
+    // The default provider must come first, see zk_ossl_provider.c.
+    if (!OSSL_PROVIDER_load(NULL, "default") || !OSSL_PROVIDER_load(NULL, "zymkey") ||
+        !(pkey = loadZkKey("zkslot:0")))
+    {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+    sslCtx = SSL_CTX_new(TLS_client_method());
+    if (!sslCtx ||
+        (argc > 6 && strcmp(argv[6], "1.2") == 0 &&
+         !SSL_CTX_set_max_proto_version(sslCtx, TLS1_2_VERSION)) ||
+        SSL_CTX_use_certificate_file(sslCtx, argv[2], SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_use_PrivateKey(sslCtx, pkey) != 1 ||
+        SSL_CTX_load_verify_locations(sslCtx, argv[3], NULL) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+    SSL_CTX_set_verify(sslCtx, SSL_VERIFY_PEER, NULL);
+    sessCache = zkSessCacheNew(ZK_STORM_WAIT_MS);
+    if (!sessCache || zkSessCacheAttach(sessCache, sslCtx) < 0)
+    {
+        return 1;
+    }
+
+    for (round = 0; round < num_rounds; round++)
+    {
+        for (i = 0; i < num_threads; i++)
+        {
+            pthread_create(&threads[i], NULL, stormConn, NULL);
+        }
+        for (i = 0; i < num_threads; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        printf("after round %d: full=%d resumed=%d failed=%d\n",
+               round, numFull, numResumed, numFailed);
+    }
+    printf("connections=%d signatures=%d\n",
+           num_threads * num_rounds, zkStubSignCount());
+
+    zkSessCacheFree(sessCache);
+    SSL_CTX_free(sslCtx);
+    EVP_PKEY_free(pkey);
+    return numFailed ? 1 : 0;
+}
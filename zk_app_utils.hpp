@@ -0,0 +1,649 @@
+/**
+ * @file zk_app_utils.hpp
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief Header-only C++ interface to Zymkey Application Utilities Library.
+ * @details
+ * This file wraps the C API in zk_app_utils.h:
+ *      1. zk::Context owns a zkCTX and closes it on destruction.
+ *      2. Arrays returned by the library are owned by move-only zk::Array
+ *         objects (zk::Buffer for bytes), which wipe and free them on
+ *         destruction.
+ *      3. Byte array inputs are taken as std::span and passed to the library
+ *         without copying.
+ *      4. Lock/unlock pick the F2F/B2F/F2B/B2B variant at compile time from
+ *         the source and destination types.
+ *      5. Errors are returned as zk::Result (std::expected) instead of
+ *         negative ints.
+ *
+ * Requires C++23. Link against libzk_app_utils as for the C API.
+ *
+ * Example:
+ *
+ *     auto ctx = zk::Context::open();
+ *     if (!ctx) return ctx.error().code;
+ *     uint8_t secret[] = { 1, 2, 3, 4 };
+ *     auto ct = ctx->lock(std::span(secret));                  // B2B
+ *     auto ok = ctx->unlock(*ct, zk::File{"/tmp/secret.bin"}); // B2F
+ */
+
+#ifndef __ZK_APP_UTILS_HPP
+#define __ZK_APP_UTILS_HPP
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <expected>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "zk_app_utils.h"
+
+#if !defined(__cpp_lib_expected)
+#error "zk_app_utils.hpp requires C++23 std::expected"
+#endif
+
+namespace zk
+{
+
+/**
+ * @brief Error returned by a failed library call.
+ */
+struct Error
+{
+    int code;           /**< the negative value returned by the C API */
+};
+
+/**
+ * @brief Result of a library call: the value on success, zk::Error on failure.
+ */
+template <typename T>
+using Result = std::expected<T, Error>;
+
+/**
+ * @brief Selects the key used for lock/unlock. See zkLockDataF2F.
+ */
+enum class Key : bool
+{
+    OneWay = false,
+    Shared = true,
+};
+
+/**
+ * @brief Names a file as the source or destination of a lock/unlock
+ *        operation.
+ */
+struct File
+{
+    const char* path;   /**< absolute path to the file */
+};
+
+/**
+ * @brief Move-only owner of an array allocated by the library.
+ */
+template <typename T>
+class Array
+{
+public:
+    Array() noexcept = default;
+
+    /**
+     * @brief Take ownership of an array of size elements returned by the
+     *        C API.
+     */
+    Array(T* data, int size) noexcept
+        : data_(data), size_(size > 0 ? static_cast<size_t>(size) : 0)
+    {
+    }
+
+    Array(Array&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0))
+    {
+    }
+
+    Array& operator=(Array&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    Array(const Array&) = delete;
+    Array& operator=(const Array&) = delete;
+
+    ~Array()
+    {
+        reset();
+    }
+
+    T* data() noexcept { return data_; }
+    const T* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    T& operator[](size_t i) noexcept { return data_[i]; }
+    const T& operator[](size_t i) const noexcept { return data_[i]; }
+
+    T* begin() noexcept { return data_; }
+    T* end() noexcept { return data_ + size_; }
+    const T* begin() const noexcept { return data_; }
+    const T* end() const noexcept { return data_ + size_; }
+
+    std::span<T> span() noexcept { return { data_, size_ }; }
+    std::span<const T> span() const noexcept { return { data_, size_ }; }
+
+    /**
+     * @brief Give up ownership of the array. The caller must free() it.
+     */
+    T* release() noexcept
+    {
+        size_ = 0;
+        return std::exchange(data_, nullptr);
+    }
+
+private:
+    /*
+     * Wipe and free the array. Buffers may hold unlocked plaintext, so the
+     * contents must not be left in freed heap memory.
+     */
+    void reset() noexcept
+    {
+        if (data_)
+        {
+            explicit_bzero(data_, size_ * sizeof(T));
+            std::free(data_);
+        }
+    }
+
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief Byte array returned by the library.
+ */
+using Buffer = Array<uint8_t>;
+
+/**
+ * @brief Perimeter event timestamps, one per channel, in seconds since the
+ *        epoch. See zkGetPerimeterDetectInfo.
+ */
+using PerimeterTimestamps = Array<uint32_t>;
+
+/**
+ * @brief Accelerometer reading and tap direction for each axis.
+ *        See zkGetAccelerometerData.
+ */
+struct AccelerometerData
+{
+    zkAccelAxisDataType x;
+    zkAccelAxisDataType y;
+    zkAccelAxisDataType z;
+};
+
+namespace detail
+{
+
+inline Result<void> check(int ret)
+{
+    if (ret < 0)
+    {
+        return std::unexpected(Error{ ret });
+    }
+    return {};
+}
+
+/*
+ * Wrap the value produced by value() on success, or the error code. Used
+ * instead of std::expected::transform, which is missing from GCC 12.
+ */
+template <typename F>
+inline auto check(int ret, F&& value) -> Result<decltype(value())>
+{
+    if (ret < 0)
+    {
+        return std::unexpected(Error{ ret });
+    }
+    return value();
+}
+
+inline bool fitsInt(size_t sz)
+{
+    return sz <= static_cast<size_t>(INT_MAX);
+}
+
+template <typename T>
+inline constexpr bool isFile = std::is_same_v<std::remove_cvref_t<T>, File>;
+
+template <typename T>
+inline constexpr bool isBytes = !isFile<T> &&
+    std::is_convertible_v<const T&, std::span<const uint8_t>>;
+
+template <typename T>
+inline constexpr bool isSource = isFile<T> || isBytes<T>;
+
+/*
+ * The C API function for each (source, destination) combination. Source is
+ * File or a byte span; Destination is File or Buffer.
+ */
+template <bool Lock, bool SrcFile, bool DstFile>
+struct DataOp;
+
+template <> struct DataOp<true, true, true>
+{
+    static constexpr auto fn = zkLockDataF2F;
+};
+template <> struct DataOp<true, false, true>
+{
+    static constexpr auto fn = zkLockDataB2F;
+};
+template <> struct DataOp<true, true, false>
+{
+    static constexpr auto fn = zkLockDataF2B;
+};
+template <> struct DataOp<true, false, false>
+{
+    static constexpr auto fn = zkLockDataB2B;
+};
+template <> struct DataOp<false, true, true>
+{
+    static constexpr auto fn = zkUnlockDataF2F;
+};
+template <> struct DataOp<false, false, true>
+{
+    static constexpr auto fn = zkUnlockDataB2F;
+};
+template <> struct DataOp<false, true, false>
+{
+    static constexpr auto fn = zkUnlockDataF2B;
+};
+template <> struct DataOp<false, false, false>
+{
+    static constexpr auto fn = zkUnlockDataB2B;
+};
+
+} // namespace detail
+
+/**
+ * @brief Zymkey context. Opened with Context::open() and closed when
+ *        destroyed.
+ */
+class Context
+{
+public:
+    /**
+     * @brief Open a Zymkey context.
+     */
+    static Result<Context> open()
+    {
+        zkCTX ctx = nullptr;
+        if (auto r = detail::check(zkOpen(&ctx)); !r)
+        {
+            return std::unexpected(r.error());
+        }
+        return Context(ctx);
+    }
+
+    Context(Context&& other) noexcept
+        : ctx_(std::exchange(other.ctx_, nullptr))
+    {
+    }
+
+    Context& operator=(Context&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            ctx_ = std::exchange(other.ctx_, nullptr);
+        }
+        return *this;
+    }
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    ~Context()
+    {
+        close();
+    }
+
+    /**
+     * @brief The underlying C context, for calls not wrapped here.
+     */
+    zkCTX get() const noexcept { return ctx_; }
+
+    /*
+     *  Random number generation.
+     */
+
+    /**
+     * @brief Fill a file with random numbers. See zkCreateRandDataFile.
+     */
+    Result<void> createRandDataFile(File dst, int rdata_sz)
+    {
+        return detail::check(zkCreateRandDataFile(ctx_, dst.path, rdata_sz));
+    }
+
+    /**
+     * @brief Get an array of random bytes. See zkGetRandBytes.
+     */
+    Result<Buffer> getRandBytes(int rdata_sz)
+    {
+        uint8_t* rdata = nullptr;
+        int ret = zkGetRandBytes(ctx_, &rdata, rdata_sz);
+        return detail::check(ret, [&] { return Buffer(rdata, rdata_sz); });
+    }
+
+    /*
+     *  Lock/unlock data.
+     */
+
+    /**
+     * @brief Lock (encrypt and sign) data into a new byte array.
+     * @details Source is either a zk::File or anything convertible to
+     *          std::span<const uint8_t>. See zkLockDataF2B and zkLockDataB2B.
+     */
+    template <typename Source>
+        requires detail::isSource<Source>
+    Result<Buffer> lock(const Source& src, Key key = Key::OneWay)
+    {
+        return toBuffer<true>(src, key);
+    }
+
+    /**
+     * @brief Lock (encrypt and sign) data into a file.
+     * @details See zkLockDataF2F and zkLockDataB2F.
+     */
+    template <typename Source>
+        requires detail::isSource<Source>
+    Result<void> lock(const Source& src, File dst, Key key = Key::OneWay)
+    {
+        return toFile<true>(src, dst, key);
+    }
+
+    /**
+     * @brief Unlock (verify and decrypt) data into a new byte array.
+     * @details See zkUnlockDataF2B and zkUnlockDataB2B.
+     */
+    template <typename Source>
+        requires detail::isSource<Source>
+    Result<Buffer> unlock(const Source& src, Key key = Key::OneWay)
+    {
+        return toBuffer<false>(src, key);
+    }
+
+    /**
+     * @brief Unlock (verify and decrypt) data into a file.
+     * @details See zkUnlockDataF2F and zkUnlockDataB2F.
+     */
+    template <typename Source>
+        requires detail::isSource<Source>
+    Result<void> unlock(const Source& src, File dst, Key key = Key::OneWay)
+    {
+        return toFile<false>(src, dst, key);
+    }
+
+    /*
+     *  ECDSA
+     */
+
+    /**
+     * @brief Sign a SHA-256 digest. See zkGenECDSASigFromDigest.
+     */
+    Result<Buffer> genECDSASigFromDigest(std::span<const uint8_t, 32> digest, int slot = 0)
+    {
+        uint8_t* sig = nullptr;
+        int sig_sz = 0;
+        int ret = zkGenECDSASigFromDigest(ctx_, digest.data(), slot, &sig, &sig_sz);
+        return detail::check(ret, [&] { return Buffer(sig, sig_sz); });
+    }
+
+    /**
+     * @brief Verify a signature with the Zymkey's public key.
+     * @return true if the signature verified, false if it did not.
+     *         See zkVerifyECDSASigFromDigest.
+     */
+    Result<bool> verifyECDSASigFromDigest(std::span<const uint8_t, 32> digest,
+                                          std::span<const uint8_t> sig,
+                                          int slot = 0)
+    {
+        if (!detail::fitsInt(sig.size()))
+        {
+            return std::unexpected(Error{ -EINVAL });
+        }
+        int ret = zkVerifyECDSASigFromDigest(ctx_, digest.data(), slot, sig.data(),
+                                             static_cast<int>(sig.size()));
+        return detail::check(ret, [&] { return ret == 1; });
+    }
+
+    /**
+     * @brief Verify a signature with a foreign public key.
+     * @return true if the signature verified, false if it did not.
+     *         See zkVerifyECDSASigFromDigestWithForeignKey.
+     */
+    Result<bool> verifyECDSASigFromDigestWithForeignKey(std::span<const uint8_t, 32> digest,
+                                                        std::span<const uint8_t> foreign_pubkey,
+                                                        std::span<const uint8_t> sig,
+                                                        bool sig_is_der,
+                                                        ZK_FOREIGN_PUBKEY_TYPE ec_curve_type)
+    {
+        if (!detail::fitsInt(foreign_pubkey.size()) || !detail::fitsInt(sig.size()))
+        {
+            return std::unexpected(Error{ -EINVAL });
+        }
+        int ret = zkVerifyECDSASigFromDigestWithForeignKey(ctx_,
+                                                           digest.data(),
+                                                           foreign_pubkey.data(),
+                                                           static_cast<int>(foreign_pubkey.size()),
+                                                           sig.data(),
+                                                           static_cast<int>(sig.size()),
+                                                           sig_is_der,
+                                                           ec_curve_type);
+        return detail::check(ret, [&] { return ret == 1; });
+    }
+
+    /**
+     * @brief Store the ECDSA public key in a PEM file.
+     *        See zkSaveECDSAPubKey2File.
+     */
+    Result<void> saveECDSAPubKey2File(File dst, int slot = 0)
+    {
+        return detail::check(zkSaveECDSAPubKey2File(ctx_, dst.path, slot));
+    }
+
+    /**
+     * @brief Get the ECDSA public key. See zkGetECDSAPubKey.
+     */
+    Result<Buffer> getECDSAPubKey(int slot = 0)
+    {
+        uint8_t* pk = nullptr;
+        int pk_sz = 0;
+        int ret = zkGetECDSAPubKey(ctx_, &pk, &pk_sz, slot);
+        return detail::check(ret, [&] { return Buffer(pk, pk_sz); });
+    }
+
+    /*
+     * LED control
+     */
+
+    Result<void> ledOff() { return detail::check(zkLEDOff(ctx_)); }
+    Result<void> ledOn() { return detail::check(zkLEDOn(ctx_)); }
+
+    /**
+     * @brief Flash the LED. See zkLEDFlash.
+     */
+    Result<void> ledFlash(uint32_t on_ms, uint32_t off_ms, uint32_t num_flashes = 0)
+    {
+        return detail::check(zkLEDFlash(ctx_, on_ms, off_ms, num_flashes));
+    }
+
+    /**
+     * @brief Set the i2c address of the Zymkey (i2c units only).
+     *        See zkSetI2CAddr.
+     */
+    Result<void> setI2CAddr(int addr)
+    {
+        return detail::check(zkSetI2CAddr(ctx_, addr));
+    }
+
+    /*
+     * Time
+     */
+
+    /**
+     * @brief Get the time from the Zymkey's RTC. See zkGetTime.
+     */
+    Result<uint32_t> getTime(bool precise_time = false)
+    {
+        uint32_t t = 0;
+        return detail::check(zkGetTime(ctx_, &t, precise_time), [&] { return t; });
+    }
+
+    /*
+     * Accelerometer
+     */
+
+    /**
+     * @brief Set the tap detection sensitivity, in percent, of one or all
+     *        axes. See zkSetTapSensitivity.
+     */
+    Result<void> setTapSensitivity(ZK_ACCEL_AXIS_TYPE axis, float pct)
+    {
+        return detail::check(zkSetTapSensitivity(ctx_, axis, pct));
+    }
+
+    /**
+     * @brief Wait for a tap event. Fails with Error{ -ETIMEDOUT } if none is
+     *        detected within timeout_ms. See zkWaitForTap.
+     */
+    Result<void> waitForTap(uint32_t timeout_ms)
+    {
+        return detail::check(zkWaitForTap(ctx_, timeout_ms));
+    }
+
+    /**
+     * @brief Get the current accelerometer data. See zkGetAccelerometerData.
+     */
+    Result<AccelerometerData> getAccelerometerData()
+    {
+        AccelerometerData d{};
+        int ret = zkGetAccelerometerData(ctx_, &d.x, &d.y, &d.z);
+        return detail::check(ret, [&] { return d; });
+    }
+
+    /*
+     * Perimeter detect
+     */
+
+    /**
+     * @brief Wait for a perimeter breach event. Fails with
+     *        Error{ -ETIMEDOUT } if none is detected within timeout_ms.
+     *        See zkWaitForPerimeterEvent.
+     */
+    Result<void> waitForPerimeterEvent(uint32_t timeout_ms)
+    {
+        return detail::check(zkWaitForPerimeterEvent(ctx_, timeout_ms));
+    }
+
+    /**
+     * @brief Get the time of the first breach on each perimeter channel, 0
+     *        for channels without events. See zkGetPerimeterDetectInfo.
+     */
+    Result<PerimeterTimestamps> getPerimeterDetectInfo()
+    {
+        uint32_t* ts = nullptr;
+        int num_ts = 0;
+        int ret = zkGetPerimeterDetectInfo(ctx_, &ts, &num_ts);
+        return detail::check(ret, [&] { return PerimeterTimestamps(ts, num_ts); });
+    }
+
+    /**
+     * @brief Clear perimeter events and rearm all channels.
+     *        See zkClearPerimeterDetectEvents.
+     */
+    Result<void> clearPerimeterDetectEvents()
+    {
+        return detail::check(zkClearPerimeterDetectEvents(ctx_));
+    }
+
+    /**
+     * @brief Set the actions (ZK_PERIMETER_EVENT_ACTION_*) taken on a breach
+     *        of a perimeter channel. See zkSetPerimeterEventAction.
+     */
+    Result<void> setPerimeterEventAction(int channel, uint32_t action_flags)
+    {
+        return detail::check(zkSetPerimeterEventAction(ctx_, channel, action_flags));
+    }
+
+private:
+    explicit Context(zkCTX ctx) noexcept : ctx_(ctx) {}
+
+    void close() noexcept
+    {
+        if (ctx_)
+        {
+            zkClose(std::exchange(ctx_, nullptr));
+        }
+    }
+
+    template <bool Lock, typename Source>
+    Result<Buffer> toBuffer(const Source& src, Key key)
+    {
+        constexpr auto fn = detail::DataOp<Lock, detail::isFile<Source>, false>::fn;
+        uint8_t* dst = nullptr;
+        int dst_sz = 0;
+        int ret;
+
+        if constexpr (detail::isFile<Source>)
+        {
+            ret = fn(ctx_, src.path, &dst, &dst_sz, static_cast<bool>(key));
+        }
+        else
+        {
+            std::span<const uint8_t> s = src;
+            if (!detail::fitsInt(s.size()))
+            {
+                return std::unexpected(Error{ -EINVAL });
+            }
+            ret = fn(ctx_, s.data(), static_cast<int>(s.size()), &dst, &dst_sz,
+                     static_cast<bool>(key));
+        }
+        return detail::check(ret, [&] { return Buffer(dst, dst_sz); });
+    }
+
+    template <bool Lock, typename Source>
+    Result<void> toFile(const Source& src, File dst, Key key)
+    {
+        constexpr auto fn = detail::DataOp<Lock, detail::isFile<Source>, true>::fn;
+
+        if constexpr (detail::isFile<Source>)
+        {
+            return detail::check(fn(ctx_, src.path, dst.path, static_cast<bool>(key)));
+        }
+        else
+        {
+            std::span<const uint8_t> s = src;
+            if (!detail::fitsInt(s.size()))
+            {
+                return std::unexpected(Error{ -EINVAL });
+            }
+            return detail::check(fn(ctx_, s.data(), static_cast<int>(s.size()), dst.path,
+                                    static_cast<bool>(key)));
+        }
+    }
+
+    zkCTX ctx_ = nullptr;
+};
+
+} // namespace zk
+
+#endif // __ZK_APP_UTILS_HPP
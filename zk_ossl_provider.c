@@ -0,0 +1,868 @@
+/**
+ * @file zk_ossl_provider.c
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief OpenSSL 3 provider exposing Zymkey key slots as EC keys.
+ * @details
+ * This provider lets any OpenSSL 3 application (libssl, the openssl command
+ * line tool, curl, the AWS IoT SDK, ...) use a Zymkey ECDSA key slot as a
+ * TLS client or server private key. The private key never leaves the
+ * module: signatures are generated with zkGenECDSASigFromDigest and the
+ * public key is read with zkGetECDSAPubKey.
+ *
+ * Keys are referenced with URIs of the form "zkslot:<slot>" through the
+ * OSSL_STORE API, e.g.:
+ *
+ *     openssl s_client -provider default -provider zymkey \
+ *                      -key zkslot:0 -cert client.pem ...
+ *
+ * The default provider must be loaded first. This provider's EC key
+ * management can only sign, so libssl must find the default provider's EC
+ * implementation first when generating ephemeral ECDHE keys.
+ *
+ * Only NIST P-256 is supported, which is the curve used by all Zymkey
+ * models.
+ *
+ * All module access is serialized through a single Zymkey context owned by
+ * the provider. Public keys are read from the module once per slot and then
+ * served from memory. See zk_ssl_sess_cache.h for avoiding the private key
+ * operation altogether on reconnect.
+ *
+ * Build as a loadable module:
+ *
+ *     cc -shared -fPIC -o zymkey.so zk_ossl_provider.c \
+ *        -lzk_app_utils -lcrypto -lpthread
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/core_object.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/provider.h>
+
+#include "zk_app_utils.h"
+
+#define ZK_PROV_NAME            "Zymkey Provider"
+#define ZK_PROV_VERSION         "1.0"
+#define ZK_PROV_PROPS           "provider=zymkey"
+#define ZK_STORE_SCHEME         "zkslot"
+
+#define ZK_EC_GROUP_NAME        "prime256v1"
+#define ZK_EC_BITS              256
+#define ZK_EC_SECURITY_BITS     128
+#define ZK_EC_COORD_SZ          32
+#define ZK_EC_PUBKEY_SZ         (1 + 2 * ZK_EC_COORD_SZ)
+#define ZK_EC_DIGEST_SZ         32
+// DER encoded ECDSA-Sig-Value: SEQUENCE { INTEGER r, INTEGER s }
+#define ZK_EC_MAX_SIG_SZ        (3 + 2 * (3 + ZK_EC_COORD_SZ))
+
+/*
+ *  Provider context.
+ */
+
+typedef struct zkProvSlotPubKey
+{
+    struct zkProvSlotPubKey* next;
+    int slot;
+    uint8_t pub[ZK_EC_PUBKEY_SZ];
+} zkProvSlotPubKey;
+
+typedef struct zkProvCtx
+{
+    const OSSL_CORE_HANDLE* handle;
+    OSSL_LIB_CTX* libctx;           /**< child library context for digests */
+    zkCTX zk_ctx;
+    pthread_mutex_t zk_lock;        /**< serializes all module access */
+    zkProvSlotPubKey* pubkeys;      /**< per-slot public key cache */
+} zkProvCtx;
+
+/*
+ * Look up the public key for a slot, reading it from the module the first
+ * time. The result is in uncompressed point format (0x04 || X || Y).
+ */
+static int zkProvGetPubKey(zkProvCtx* pctx, int slot, uint8_t* pub)
+{
+    zkProvSlotPubKey* e;
+    uint8_t* pk = NULL;
+    int pk_sz = 0;
+    int ret;
+
+    pthread_mutex_lock(&pctx->zk_lock);
+    for (e = pctx->pubkeys; e; e = e->next)
+    {
+        if (e->slot == slot)
+        {
+            memcpy(pub, e->pub, ZK_EC_PUBKEY_SZ);
+            pthread_mutex_unlock(&pctx->zk_lock);
+            return 0;
+        }
+    }
+
+    ret = zkGetECDSAPubKey(pctx->zk_ctx, &pk, &pk_sz, slot);
+    if (ret == 0)
+    {
+        // The module returns the raw X || Y coordinates.
+        if (pk_sz == 2 * ZK_EC_COORD_SZ)
+        {
+            pub[0] = POINT_CONVERSION_UNCOMPRESSED;
+            memcpy(pub + 1, pk, pk_sz);
+        }
+        else if (pk_sz == ZK_EC_PUBKEY_SZ && pk[0] == POINT_CONVERSION_UNCOMPRESSED)
+        {
+            memcpy(pub, pk, pk_sz);
+        }
+        else
+        {
+            ret = -EINVAL;
+        }
+    }
+    free(pk);
+
+    if (ret == 0)
+    {
+        e = calloc(1, sizeof(*e));
+        if (e)
+        {
+            e->slot = slot;
+            memcpy(e->pub, pub, ZK_EC_PUBKEY_SZ);
+            e->next = pctx->pubkeys;
+            pctx->pubkeys = e;
+        }
+    }
+    pthread_mutex_unlock(&pctx->zk_lock);
+    return ret;
+}
+
+/*
+ *  Key management.
+ */
+
+typedef struct zkProvKey
+{
+    zkProvCtx* pctx;
+    int slot;                       /**< -1 for an imported public key */
+    int has_pub;
+    uint8_t pub[ZK_EC_PUBKEY_SZ];
+} zkProvKey;
+
+static void* zkKeyNew(void* provctx)
+{
+    zkProvKey* key = OPENSSL_zalloc(sizeof(*key));
+
+    if (key)
+    {
+        key->pctx = provctx;
+        key->slot = -1;
+    }
+    return key;
+}
+
+static void zkKeyFree(void* keydata)
+{
+    OPENSSL_free(keydata);
+}
+
+static void* zkKeyDup(const void* keydata, int selection)
+{
+    zkProvKey* key = OPENSSL_memdup(keydata, sizeof(zkProvKey));
+
+    (void)selection;
+    return key;
+}
+
+static void* zkKeyLoad(const void* reference, size_t reference_sz)
+{
+    zkProvKey* key;
+
+    if (!reference || reference_sz != sizeof(key))
+    {
+        return NULL;
+    }
+    // The store loader hands over ownership of the key object.
+    key = *(zkProvKey**)reference;
+    *(zkProvKey**)reference = NULL;
+    return key;
+}
+
+static int zkKeyHas(const void* keydata, int selection)
+{
+    const zkProvKey* key = keydata;
+
+    if (!key)
+    {
+        return 0;
+    }
+    if ((selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) && key->slot < 0)
+    {
+        return 0;
+    }
+    if ((selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY) && !key->has_pub)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static int zkKeyMatch(const void* keydata1, const void* keydata2, int selection)
+{
+    const zkProvKey* k1 = keydata1;
+    const zkProvKey* k2 = keydata2;
+
+    if (selection & OSSL_KEYMGMT_SELECT_KEYPAIR)
+    {
+        return k1->has_pub && k2->has_pub &&
+               memcmp(k1->pub, k2->pub, ZK_EC_PUBKEY_SZ) == 0;
+    }
+    // Only one curve, so domain parameters always match.
+    return 1;
+}
+
+static const char* zkKeyQueryOperationName(int operation_id)
+{
+    return operation_id == OSSL_OP_SIGNATURE ? "ECDSA" : NULL;
+}
+
+static int zkKeyGetParams(void* keydata, OSSL_PARAM params[])
+{
+    zkProvKey* key = keydata;
+    OSSL_PARAM* p;
+
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_BITS)) &&
+        !OSSL_PARAM_set_int(p, ZK_EC_BITS))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_SECURITY_BITS)) &&
+        !OSSL_PARAM_set_int(p, ZK_EC_SECURITY_BITS))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_MAX_SIZE)) &&
+        !OSSL_PARAM_set_int(p, ZK_EC_MAX_SIG_SZ))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_GROUP_NAME)) &&
+        !OSSL_PARAM_set_utf8_string(p, ZK_EC_GROUP_NAME))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_DEFAULT_DIGEST)) &&
+        !OSSL_PARAM_set_utf8_string(p, "SHA256"))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_EC_POINT_CONVERSION_FORMAT)) &&
+        !OSSL_PARAM_set_utf8_string(p, OSSL_PKEY_EC_POINT_CONVERSION_FORMAT_UNCOMPRESSED))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_PUB_KEY)) &&
+        (!key->has_pub || !OSSL_PARAM_set_octet_string(p, key->pub, ZK_EC_PUBKEY_SZ)))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PKEY_PARAM_ENCODED_PUBLIC_KEY)) &&
+        (!key->has_pub || !OSSL_PARAM_set_octet_string(p, key->pub, ZK_EC_PUBKEY_SZ)))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* zkKeyGettableParams(void* provctx)
+{
+    static const OSSL_PARAM gettable[] =
+    {
+        OSSL_PARAM_int(OSSL_PKEY_PARAM_BITS, NULL),
+        OSSL_PARAM_int(OSSL_PKEY_PARAM_SECURITY_BITS, NULL),
+        OSSL_PARAM_int(OSSL_PKEY_PARAM_MAX_SIZE, NULL),
+        OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+        OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_DEFAULT_DIGEST, NULL, 0),
+        OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_EC_POINT_CONVERSION_FORMAT, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_ENCODED_PUBLIC_KEY, NULL, 0),
+        OSSL_PARAM_END
+    };
+
+    (void)provctx;
+    return gettable;
+}
+
+static const OSSL_PARAM zkKeyPublicTypes[] =
+{
+    OSSL_PARAM_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, NULL, 0),
+    OSSL_PARAM_octet_string(OSSL_PKEY_PARAM_PUB_KEY, NULL, 0),
+    OSSL_PARAM_END
+};
+
+/*
+ * Only the public half can be exported. This lets libcrypto compare the
+ * key against a certificate held by another provider.
+ */
+static int zkKeyExport(void* keydata,
+                       int selection,
+                       OSSL_CALLBACK* param_cb,
+                       void* cbarg)
+{
+    zkProvKey* key = keydata;
+    OSSL_PARAM params[3];
+    int n = 0;
+
+    if (selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY)
+    {
+        return 0;
+    }
+    if (selection & OSSL_KEYMGMT_SELECT_ALL_PARAMETERS)
+    {
+        params[n++] = OSSL_PARAM_construct_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME,
+                                                       ZK_EC_GROUP_NAME, 0);
+    }
+    if (selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY)
+    {
+        if (!key->has_pub)
+        {
+            return 0;
+        }
+        params[n++] = OSSL_PARAM_construct_octet_string(OSSL_PKEY_PARAM_PUB_KEY,
+                                                        key->pub,
+                                                        ZK_EC_PUBKEY_SZ);
+    }
+    params[n] = OSSL_PARAM_construct_end();
+    return param_cb(params, cbarg);
+}
+
+static int zkKeyImport(void* keydata, int selection, const OSSL_PARAM params[])
+{
+    zkProvKey* key = keydata;
+    const OSSL_PARAM* p;
+    const char* group = NULL;
+    const void* pub = NULL;
+    size_t pub_sz = 0;
+
+    if (selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY)
+    {
+        return 0;
+    }
+    p = OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_GROUP_NAME);
+    if (p && (!OSSL_PARAM_get_utf8_string_ptr(p, &group) ||
+              (OPENSSL_strcasecmp(group, ZK_EC_GROUP_NAME) != 0 &&
+               OPENSSL_strcasecmp(group, "P-256") != 0)))
+    {
+        return 0;
+    }
+    if (selection & OSSL_KEYMGMT_SELECT_PUBLIC_KEY)
+    {
+        p = OSSL_PARAM_locate_const(params, OSSL_PKEY_PARAM_PUB_KEY);
+        if (!p || !OSSL_PARAM_get_octet_string_ptr(p, &pub, &pub_sz) ||
+            pub_sz != ZK_EC_PUBKEY_SZ)
+        {
+            return 0;
+        }
+        memcpy(key->pub, pub, ZK_EC_PUBKEY_SZ);
+        key->has_pub = 1;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* zkKeyPortableTypes(int selection)
+{
+    return (selection & OSSL_KEYMGMT_SELECT_PRIVATE_KEY) ? NULL : zkKeyPublicTypes;
+}
+
+static const OSSL_DISPATCH zkKeyMgmtFunctions[] =
+{
+    { OSSL_FUNC_KEYMGMT_NEW, (void (*)(void))zkKeyNew },
+    { OSSL_FUNC_KEYMGMT_FREE, (void (*)(void))zkKeyFree },
+    { OSSL_FUNC_KEYMGMT_DUP, (void (*)(void))zkKeyDup },
+    { OSSL_FUNC_KEYMGMT_LOAD, (void (*)(void))zkKeyLoad },
+    { OSSL_FUNC_KEYMGMT_HAS, (void (*)(void))zkKeyHas },
+    { OSSL_FUNC_KEYMGMT_MATCH, (void (*)(void))zkKeyMatch },
+    { OSSL_FUNC_KEYMGMT_QUERY_OPERATION_NAME, (void (*)(void))zkKeyQueryOperationName },
+    { OSSL_FUNC_KEYMGMT_GET_PARAMS, (void (*)(void))zkKeyGetParams },
+    { OSSL_FUNC_KEYMGMT_GETTABLE_PARAMS, (void (*)(void))zkKeyGettableParams },
+    { OSSL_FUNC_KEYMGMT_EXPORT, (void (*)(void))zkKeyExport },
+    { OSSL_FUNC_KEYMGMT_EXPORT_TYPES, (void (*)(void))zkKeyPortableTypes },
+    { OSSL_FUNC_KEYMGMT_IMPORT, (void (*)(void))zkKeyImport },
+    { OSSL_FUNC_KEYMGMT_IMPORT_TYPES, (void (*)(void))zkKeyPortableTypes },
+    { 0, NULL }
+};
+
+/*
+ *  ECDSA signature.
+ */
+
+typedef struct zkProvSigCtx
+{
+    zkProvCtx* pctx;
+    zkProvKey* key;
+    EVP_MD_CTX* mdctx;              /**< used by the digest-sign functions */
+} zkProvSigCtx;
+
+static void* zkSigNewCtx(void* provctx, const char* propq)
+{
+    zkProvSigCtx* sctx = OPENSSL_zalloc(sizeof(*sctx));
+
+    (void)propq;
+    if (sctx)
+    {
+        sctx->pctx = provctx;
+    }
+    return sctx;
+}
+
+static void zkSigFreeCtx(void* ctx)
+{
+    zkProvSigCtx* sctx = ctx;
+
+    if (sctx)
+    {
+        EVP_MD_CTX_free(sctx->mdctx);
+        OPENSSL_free(sctx);
+    }
+}
+
+static void* zkSigDupCtx(void* ctx)
+{
+    zkProvSigCtx* src = ctx;
+    zkProvSigCtx* dst = OPENSSL_memdup(src, sizeof(*src));
+
+    if (!dst)
+    {
+        return NULL;
+    }
+    dst->mdctx = NULL;
+    if (src->mdctx &&
+        (!(dst->mdctx = EVP_MD_CTX_new()) || !EVP_MD_CTX_copy_ex(dst->mdctx, src->mdctx)))
+    {
+        zkSigFreeCtx(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static int zkSigSignInit(void* ctx, void* provkey, const OSSL_PARAM params[])
+{
+    zkProvSigCtx* sctx = ctx;
+    zkProvKey* key = provkey;
+
+    (void)params;
+    if (!key || key->slot < 0)
+    {
+        return 0;
+    }
+    sctx->key = key;
+    return 1;
+}
+
+/*
+ * Sign a digest in the module and DER encode the raw r || s signature it
+ * returns. The module only takes 32 byte digests, so the digest is converted
+ * the way ECDSA over P-256 does it anyway (FIPS 186-4 section 6.4): longer
+ * digests (e.g. SHA-384 in TLS) are truncated to their leftmost 32 bytes and
+ * shorter ones are left padded with zeros, which keeps their integer value.
+ */
+static int zkSigSign(void* ctx,
+                     unsigned char* sig,
+                     size_t* siglen,
+                     size_t sigsize,
+                     const unsigned char* tbs,
+                     size_t tbslen)
+{
+    zkProvSigCtx* sctx = ctx;
+    ECDSA_SIG* esig = NULL;
+    BIGNUM* r = NULL;
+    BIGNUM* s = NULL;
+    uint8_t digest[ZK_EC_DIGEST_SZ] = {0};
+    uint8_t* raw = NULL;
+    int raw_sz = 0;
+    unsigned char* p = sig;
+    int der_sz;
+    int ret;
+
+    if (!sig)
+    {
+        *siglen = ZK_EC_MAX_SIG_SZ;
+        return 1;
+    }
+    if (sigsize < ZK_EC_MAX_SIG_SZ)
+    {
+        return 0;
+    }
+    if (tbslen >= ZK_EC_DIGEST_SZ)
+    {
+        memcpy(digest, tbs, ZK_EC_DIGEST_SZ);
+    }
+    else
+    {
+        memcpy(digest + ZK_EC_DIGEST_SZ - tbslen, tbs, tbslen);
+    }
+
+    // The Zymkey processes one command at a time, so concurrent handshakes
+    // queue on the module lock instead of contending in the driver.
+    pthread_mutex_lock(&sctx->pctx->zk_lock);
+    ret = zkGenECDSASigFromDigest(sctx->pctx->zk_ctx, digest, sctx->key->slot,
+                                  &raw, &raw_sz);
+    pthread_mutex_unlock(&sctx->pctx->zk_lock);
+    if (ret < 0 || raw_sz != 2 * ZK_EC_COORD_SZ)
+    {
+        free(raw);
+        return 0;
+    }
+
+    r = BN_bin2bn(raw, ZK_EC_COORD_SZ, NULL);
+    s = BN_bin2bn(raw + ZK_EC_COORD_SZ, ZK_EC_COORD_SZ, NULL);
+    free(raw);
+    esig = ECDSA_SIG_new();
+    if (!r || !s || !esig || !ECDSA_SIG_set0(esig, r, s))
+    {
+        BN_free(r);
+        BN_free(s);
+        ECDSA_SIG_free(esig);
+        return 0;
+    }
+    der_sz = i2d_ECDSA_SIG(esig, &p);
+    ECDSA_SIG_free(esig);
+    if (der_sz <= 0)
+    {
+        return 0;
+    }
+    *siglen = (size_t)der_sz;
+    return 1;
+}
+
+static int zkSigDigestSignInit(void* ctx,
+                               const char* mdname,
+                               void* provkey,
+                               const OSSL_PARAM params[])
+{
+    zkProvSigCtx* sctx = ctx;
+    EVP_MD* md;
+    int ok;
+
+    if (!zkSigSignInit(ctx, provkey, params))
+    {
+        return 0;
+    }
+    md = EVP_MD_fetch(sctx->pctx->libctx, mdname ? mdname : "SHA256", NULL);
+    if (!md)
+    {
+        return 0;
+    }
+    if (!sctx->mdctx)
+    {
+        sctx->mdctx = EVP_MD_CTX_new();
+    }
+    ok = sctx->mdctx && EVP_DigestInit_ex2(sctx->mdctx, md, NULL);
+    EVP_MD_free(md);
+    return ok;
+}
+
+static int zkSigDigestSignUpdate(void* ctx, const unsigned char* data, size_t datalen)
+{
+    zkProvSigCtx* sctx = ctx;
+
+    return sctx->mdctx && EVP_DigestUpdate(sctx->mdctx, data, datalen);
+}
+
+static int zkSigDigestSignFinal(void* ctx,
+                                unsigned char* sig,
+                                size_t* siglen,
+                                size_t sigsize)
+{
+    zkProvSigCtx* sctx = ctx;
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_sz = 0;
+
+    if (!sig)
+    {
+        *siglen = ZK_EC_MAX_SIG_SZ;
+        return 1;
+    }
+    if (!sctx->mdctx || !EVP_DigestFinal_ex(sctx->mdctx, digest, &digest_sz))
+    {
+        return 0;
+    }
+    return zkSigSign(ctx, sig, siglen, sigsize, digest, digest_sz);
+}
+
+static int zkSigSetCtxParams(void* ctx, const OSSL_PARAM params[])
+{
+    (void)ctx;
+    (void)params;
+    return 1;
+}
+
+static const OSSL_PARAM* zkSigSettableCtxParams(void* ctx, void* provctx)
+{
+    static const OSSL_PARAM settable[] = { OSSL_PARAM_END };
+
+    (void)ctx;
+    (void)provctx;
+    return settable;
+}
+
+static const OSSL_DISPATCH zkSignatureFunctions[] =
+{
+    { OSSL_FUNC_SIGNATURE_NEWCTX, (void (*)(void))zkSigNewCtx },
+    { OSSL_FUNC_SIGNATURE_FREECTX, (void (*)(void))zkSigFreeCtx },
+    { OSSL_FUNC_SIGNATURE_DUPCTX, (void (*)(void))zkSigDupCtx },
+    { OSSL_FUNC_SIGNATURE_SIGN_INIT, (void (*)(void))zkSigSignInit },
+    { OSSL_FUNC_SIGNATURE_SIGN, (void (*)(void))zkSigSign },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_INIT, (void (*)(void))zkSigDigestSignInit },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_UPDATE, (void (*)(void))zkSigDigestSignUpdate },
+    { OSSL_FUNC_SIGNATURE_DIGEST_SIGN_FINAL, (void (*)(void))zkSigDigestSignFinal },
+    { OSSL_FUNC_SIGNATURE_SET_CTX_PARAMS, (void (*)(void))zkSigSetCtxParams },
+    { OSSL_FUNC_SIGNATURE_SETTABLE_CTX_PARAMS, (void (*)(void))zkSigSettableCtxParams },
+    { 0, NULL }
+};
+
+/*
+ *  Key store ("zkslot:<slot>" URIs).
+ */
+
+typedef struct zkProvStoreCtx
+{
+    zkProvCtx* pctx;
+    int slot;
+    int eof;
+} zkProvStoreCtx;
+
+static void* zkStoreOpen(void* provctx, const char* uri)
+{
+    zkProvStoreCtx* sctx;
+    const char* p;
+    char* end;
+    long slot;
+
+    if (OPENSSL_strncasecmp(uri, ZK_STORE_SCHEME ":", sizeof(ZK_STORE_SCHEME)) != 0)
+    {
+        return NULL;
+    }
+    p = uri + sizeof(ZK_STORE_SCHEME);
+    slot = strtol(p, &end, 10);
+    if (end == p || *end != '\0' || slot < 0 || slot > 0xffff)
+    {
+        return NULL;
+    }
+
+    sctx = OPENSSL_zalloc(sizeof(*sctx));
+    if (sctx)
+    {
+        sctx->pctx = provctx;
+        sctx->slot = (int)slot;
+    }
+    return sctx;
+}
+
+static int zkStoreLoad(void* ctx,
+                       OSSL_CALLBACK* object_cb,
+                       void* object_cbarg,
+                       OSSL_PASSPHRASE_CALLBACK* pw_cb,
+                       void* pw_cbarg)
+{
+    zkProvStoreCtx* sctx = ctx;
+    OSSL_PARAM params[4];
+    int object_type = OSSL_OBJECT_PKEY;
+    zkProvKey* key;
+    int ok;
+
+    (void)pw_cb;
+    (void)pw_cbarg;
+    sctx->eof = 1;
+
+    key = zkKeyNew(sctx->pctx);
+    if (!key)
+    {
+        return 0;
+    }
+    key->slot = sctx->slot;
+    if (zkProvGetPubKey(sctx->pctx, key->slot, key->pub) < 0)
+    {
+        zkKeyFree(key);
+        return 0;
+    }
+    key->has_pub = 1;
+
+    params[0] = OSSL_PARAM_construct_int(OSSL_OBJECT_PARAM_TYPE, &object_type);
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_OBJECT_PARAM_DATA_TYPE, "EC", 0);
+    params[2] = OSSL_PARAM_construct_octet_string(OSSL_OBJECT_PARAM_REFERENCE,
+                                                  &key, sizeof(key));
+    params[3] = OSSL_PARAM_construct_end();
+    ok = object_cb(params, object_cbarg);
+
+    // Still set if the key was not claimed by zkKeyLoad.
+    zkKeyFree(key);
+    return ok;
+}
+
+static int zkStoreEof(void* ctx)
+{
+    return ((zkProvStoreCtx*)ctx)->eof;
+}
+
+static int zkStoreClose(void* ctx)
+{
+    OPENSSL_free(ctx);
+    return 1;
+}
+
+static int zkStoreSetCtxParams(void* ctx, const OSSL_PARAM params[])
+{
+    (void)ctx;
+    (void)params;
+    return 1;
+}
+
+static const OSSL_DISPATCH zkStoreFunctions[] =
+{
+    { OSSL_FUNC_STORE_OPEN, (void (*)(void))zkStoreOpen },
+    { OSSL_FUNC_STORE_LOAD, (void (*)(void))zkStoreLoad },
+    { OSSL_FUNC_STORE_EOF, (void (*)(void))zkStoreEof },
+    { OSSL_FUNC_STORE_CLOSE, (void (*)(void))zkStoreClose },
+    { OSSL_FUNC_STORE_SET_CTX_PARAMS, (void (*)(void))zkStoreSetCtxParams },
+    { 0, NULL }
+};
+
+/*
+ *  Provider entry points.
+ */
+
+static const OSSL_ALGORITHM zkKeyMgmtAlgs[] =
+{
+    { "EC:id-ecPublicKey:1.2.840.10045.2.1", ZK_PROV_PROPS, zkKeyMgmtFunctions,
+      "Zymkey EC key slot" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM zkSignatureAlgs[] =
+{
+    { "ECDSA", ZK_PROV_PROPS, zkSignatureFunctions, "Zymkey ECDSA" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM zkStoreAlgs[] =
+{
+    { ZK_STORE_SCHEME, ZK_PROV_PROPS, zkStoreFunctions, "Zymkey key slots" },
+    { NULL, NULL, NULL, NULL }
+};
+
+static const OSSL_ALGORITHM* zkProvQueryOperation(void* provctx,
+                                                  int operation_id,
+                                                  int* no_cache)
+{
+    (void)provctx;
+    *no_cache = 0;
+    switch (operation_id)
+    {
+        case OSSL_OP_KEYMGMT:
+            return zkKeyMgmtAlgs;
+        case OSSL_OP_SIGNATURE:
+            return zkSignatureAlgs;
+        case OSSL_OP_STORE:
+            return zkStoreAlgs;
+    }
+    return NULL;
+}
+
+static int zkProvGetParams(void* provctx, OSSL_PARAM params[])
+{
+    OSSL_PARAM* p;
+
+    (void)provctx;
+    if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) &&
+        !OSSL_PARAM_set_utf8_ptr(p, ZK_PROV_NAME))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION)) &&
+        !OSSL_PARAM_set_utf8_ptr(p, ZK_PROV_VERSION))
+    {
+        return 0;
+    }
+    if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) &&
+        !OSSL_PARAM_set_int(p, 1))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM* zkProvGettableParams(void* provctx)
+{
+    static const OSSL_PARAM gettable[] =
+    {
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, NULL, 0),
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_VERSION, NULL, 0),
+        OSSL_PARAM_int(OSSL_PROV_PARAM_STATUS, NULL),
+        OSSL_PARAM_END
+    };
+
+    (void)provctx;
+    return gettable;
+}
+
+static void zkProvTeardown(void* provctx)
+{
+    zkProvCtx* pctx = provctx;
+    zkProvSlotPubKey* e;
+
+    while ((e = pctx->pubkeys))
+    {
+        pctx->pubkeys = e->next;
+        free(e);
+    }
+    zkClose(pctx->zk_ctx);
+    OSSL_LIB_CTX_free(pctx->libctx);
+    pthread_mutex_destroy(&pctx->zk_lock);
+    OPENSSL_free(pctx);
+}
+
+static const OSSL_DISPATCH zkProvFunctions[] =
+{
+    { OSSL_FUNC_PROVIDER_TEARDOWN, (void (*)(void))zkProvTeardown },
+    { OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (void (*)(void))zkProvGettableParams },
+    { OSSL_FUNC_PROVIDER_GET_PARAMS, (void (*)(void))zkProvGetParams },
+    { OSSL_FUNC_PROVIDER_QUERY_OPERATION, (void (*)(void))zkProvQueryOperation },
+    { 0, NULL }
+};
+
+int OSSL_provider_init(const OSSL_CORE_HANDLE* handle,
+                       const OSSL_DISPATCH* in,
+                       const OSSL_DISPATCH** out,
+                       void** provctx)
+{
+    zkProvCtx* pctx;
+
+    pctx = OPENSSL_zalloc(sizeof(*pctx));
+    if (!pctx)
+    {
+        return 0;
+    }
+    pctx->handle = handle;
+    pthread_mutex_init(&pctx->zk_lock, NULL);
+
+    pctx->libctx = OSSL_LIB_CTX_new_child(handle, in);
+    if (!pctx->libctx || zkOpen(&pctx->zk_ctx) < 0)
+    {
+        OSSL_LIB_CTX_free(pctx->libctx);
+        pthread_mutex_destroy(&pctx->zk_lock);
+        OPENSSL_free(pctx);
+        return 0;
+    }
+
+    *out = zkProvFunctions;
+    *provctx = pctx;
+    return 1;
+}
@@ -0,0 +1,505 @@
+/**
+ * @file zk_rand_drbg.c
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief High-volume random data generation seeded by the Zymkey.
+ * @details
+ * Implements the CTR_DRBG mechanism from NIST SP 800-90A section 10.2.1
+ * using AES-256 without a derivation function. The Zymkey supplies the full
+ * entropy input for instantiation and for every reseed.
+ *
+ * The AES-CTR mode of libcrypto is used to produce the keystream blocks
+ * AES(Key, V+1), AES(Key, V+2), ... in a single call, which lets libcrypto
+ * use AES-NI/ARMv8 crypto extensions and pipeline the blocks.
+ */
+
+#define _GNU_SOURCE
+// 64-bit file offsets on 32-bit targets (armhf Raspberry Pi OS).
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+#include "zk_rand_drbg.h"
+
+#define DRBG_KEY_SZ         32
+#define DRBG_BLOCK_SZ       16
+#define DRBG_SEED_SZ        (DRBG_KEY_SZ + DRBG_BLOCK_SZ)
+#define DRBG_BUF_ALIGN      4096
+
+// Chunk offsets and the file size are passed to pwrite/posix_fallocate.
+typedef char zkDRBGOffTCheck[sizeof(off_t) >= sizeof(uint64_t) ? 1 : -1];
+
+typedef struct zkDRBGState
+{
+    EVP_CIPHER_CTX* cipher;
+    uint8_t key[DRBG_KEY_SZ];
+    uint8_t v[DRBG_BLOCK_SZ];
+    uint64_t reseed_counter;
+} zkDRBGState;
+
+typedef struct zkRandJob
+{
+    zkCTX zk_ctx;
+    pthread_mutex_t lock;           /**< guards zk_ctx, next_chunk, bytes_done */
+    pthread_mutex_t cb_lock;        /**< serializes progress_cb, guards bytes_reported */
+    uint64_t total_sz;
+    uint64_t num_chunks;
+    uint64_t next_chunk;
+    uint64_t bytes_done;
+    uint64_t bytes_reported;
+    int fd;                         /**< destination file, or -1 */
+    uint8_t* mem;                   /**< destination buffer if fd is -1 */
+    zkRandProgressCB progress_cb;
+    void* user_data;
+    int ret;                        /**< first error seen by any worker */
+} zkRandJob;
+
+typedef struct zkRandWorker
+{
+    pthread_t thread;
+    zkRandJob* job;
+    uint32_t idx;
+} zkRandWorker;
+
+/*
+ *  CTR_DRBG primitives.
+ */
+
+static void drbgAddToV(uint8_t* v, uint64_t n)
+{
+    int i;
+    for (i = DRBG_BLOCK_SZ - 1; i >= 0 && n; i--)
+    {
+        n += v[i];
+        v[i] = (uint8_t)n;
+        n >>= 8;
+    }
+}
+
+/*
+ * Write AES(Key, V+1) || AES(Key, V+2) || ... to out and advance V by the
+ * number of blocks used. out_sz must be a multiple of the block size.
+ */
+static int drbgKeystream(zkDRBGState* st, uint8_t* out, size_t out_sz)
+{
+    uint8_t iv[DRBG_BLOCK_SZ];
+    int len;
+
+    memcpy(iv, st->v, DRBG_BLOCK_SZ);
+    drbgAddToV(iv, 1);
+    memset(out, 0, out_sz);
+    if (!EVP_EncryptInit_ex(st->cipher, EVP_aes_256_ctr(), NULL, st->key, iv) ||
+        !EVP_EncryptUpdate(st->cipher, out, &len, out, (int)out_sz))
+    {
+        return -EIO;
+    }
+    drbgAddToV(st->v, out_sz / DRBG_BLOCK_SZ);
+    return 0;
+}
+
+/* CTR_DRBG_Update (SP 800-90A 10.2.1.2) */
+static int drbgUpdate(zkDRBGState* st, const uint8_t* provided_data)
+{
+    uint8_t temp[DRBG_SEED_SZ];
+    int i;
+    int ret;
+
+    ret = drbgKeystream(st, temp, sizeof(temp));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (provided_data)
+    {
+        for (i = 0; i < DRBG_SEED_SZ; i++)
+        {
+            temp[i] ^= provided_data[i];
+        }
+    }
+    memcpy(st->key, temp, DRBG_KEY_SZ);
+    memcpy(st->v, temp + DRBG_KEY_SZ, DRBG_BLOCK_SZ);
+    OPENSSL_cleanse(temp, sizeof(temp));
+    return 0;
+}
+
+/*
+ * Fetch DRBG_SEED_SZ bytes of entropy from the Zymkey, mix in the
+ * personalization (the worker index) and run CTR_DRBG_Update. Used for both
+ * instantiate (10.2.1.3.1) and reseed (10.2.1.4.1).
+ */
+static int drbgSeed(zkDRBGState* st, zkRandJob* job, uint32_t idx)
+{
+    uint8_t* entropy = NULL;
+    int ret;
+    int i;
+
+    pthread_mutex_lock(&job->lock);
+    ret = zkGetRandBytes(job->zk_ctx, &entropy, DRBG_SEED_SZ);
+    pthread_mutex_unlock(&job->lock);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        entropy[DRBG_SEED_SZ - 1 - i] ^= (uint8_t)(idx >> (8 * i));
+    }
+    ret = drbgUpdate(st, entropy);
+    OPENSSL_cleanse(entropy, DRBG_SEED_SZ);
+    free(entropy);
+    st->reseed_counter = 1;
+    return ret;
+}
+
+static int drbgInstantiate(zkDRBGState* st, zkRandJob* job, uint32_t idx)
+{
+    memset(st, 0, sizeof(*st));
+    st->cipher = EVP_CIPHER_CTX_new();
+    if (!st->cipher)
+    {
+        return -ENOMEM;
+    }
+    return drbgSeed(st, job, idx);
+}
+
+static void drbgUninstantiate(zkDRBGState* st)
+{
+    EVP_CIPHER_CTX_free(st->cipher);
+    OPENSSL_cleanse(st, sizeof(*st));
+}
+
+/*
+ * CTR_DRBG_Generate (SP 800-90A 10.2.1.5.1), split into requests of at most
+ * ZK_DRBG_MAX_REQUEST_SZ bytes. out_sz must be a multiple of the block size.
+ */
+static int drbgGenerate(zkDRBGState* st,
+                        zkRandJob* job,
+                        uint32_t idx,
+                        uint8_t* out,
+                        size_t out_sz)
+{
+    size_t n;
+    int ret;
+
+    while (out_sz)
+    {
+        if (st->reseed_counter > ZK_DRBG_RESEED_INTERVAL)
+        {
+            ret = drbgSeed(st, job, idx);
+            if (ret < 0)
+            {
+                return ret;
+            }
+        }
+        n = out_sz < ZK_DRBG_MAX_REQUEST_SZ ? out_sz : ZK_DRBG_MAX_REQUEST_SZ;
+        ret = drbgKeystream(st, out, n);
+        if (ret == 0)
+        {
+            ret = drbgUpdate(st, NULL);
+        }
+        if (ret < 0)
+        {
+            return ret;
+        }
+        st->reseed_counter++;
+        out += n;
+        out_sz -= n;
+    }
+    return 0;
+}
+
+/*
+ *  Worker threads.
+ */
+
+static int writeAll(int fd, const uint8_t* buf, size_t sz, uint64_t offset)
+{
+    ssize_t n;
+
+    while (sz)
+    {
+        n = pwrite(fd, buf, sz, (off_t)offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        buf += n;
+        sz -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+static void* randWorker(void* arg)
+{
+    zkRandWorker* w = (zkRandWorker*)arg;
+    zkRandJob* job = w->job;
+    zkDRBGState st;
+    uint8_t* buf = NULL;
+    uint8_t* out;
+    uint64_t chunk;
+    uint64_t offset;
+    uint64_t done;
+    size_t sz;
+    int ret;
+
+    ret = drbgInstantiate(&st, job, w->idx);
+    if (ret == 0 && posix_memalign((void**)&buf, DRBG_BUF_ALIGN, ZK_DRBG_CHUNK_SZ))
+    {
+        buf = NULL;
+        ret = -ENOMEM;
+    }
+
+    while (ret == 0)
+    {
+        pthread_mutex_lock(&job->lock);
+        chunk = job->ret < 0 ? job->num_chunks : job->next_chunk++;
+        pthread_mutex_unlock(&job->lock);
+        if (chunk >= job->num_chunks)
+        {
+            break;
+        }
+
+        offset = chunk * ZK_DRBG_CHUNK_SZ;
+        sz = job->total_sz - offset < ZK_DRBG_CHUNK_SZ ?
+             (size_t)(job->total_sz - offset) : ZK_DRBG_CHUNK_SZ;
+
+        // Generate whole blocks into the aligned buffer unless the chunk can
+        // go straight to the caller's memory.
+        out = (job->fd < 0 && sz % DRBG_BLOCK_SZ == 0) ? job->mem + offset : buf;
+        ret = drbgGenerate(&st, job, w->idx, out,
+                           (sz + DRBG_BLOCK_SZ - 1) & ~(size_t)(DRBG_BLOCK_SZ - 1));
+        if (ret < 0)
+        {
+            break;
+        }
+        if (job->fd >= 0)
+        {
+            ret = writeAll(job->fd, buf, sz, offset);
+        }
+        else if (out == buf)
+        {
+            memcpy(job->mem + offset, buf, sz);
+        }
+
+        if (ret < 0)
+        {
+            break;
+        }
+        pthread_mutex_lock(&job->lock);
+        job->bytes_done += sz;
+        done = job->bytes_done;
+        pthread_mutex_unlock(&job->lock);
+
+        // A slow callback must not hold up the other workers' chunk
+        // dispatch. Workers can reach this point out of order, so stale
+        // counts are skipped to keep the reported progress increasing.
+        if (job->progress_cb)
+        {
+            pthread_mutex_lock(&job->cb_lock);
+            if (done > job->bytes_reported)
+            {
+                job->bytes_reported = done;
+                job->progress_cb(done, job->total_sz, job->user_data);
+            }
+            pthread_mutex_unlock(&job->cb_lock);
+        }
+    }
+
+    if (ret < 0)
+    {
+        pthread_mutex_lock(&job->lock);
+        if (job->ret == 0)
+        {
+            job->ret = ret;
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+    if (buf)
+    {
+        OPENSSL_cleanse(buf, ZK_DRBG_CHUNK_SZ);
+        free(buf);
+    }
+    if (st.cipher)
+    {
+        drbgUninstantiate(&st);
+    }
+    return NULL;
+}
+
+static int runRandJob(zkRandJob* job)
+{
+    zkRandWorker* workers;
+    long ncpu;
+    uint32_t nthreads;
+    uint32_t i;
+    uint32_t started = 0;
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpu > 0 ? (uint32_t)ncpu : 1;
+    if (nthreads > job->num_chunks)
+    {
+        nthreads = (uint32_t)job->num_chunks;
+    }
+
+    workers = calloc(nthreads, sizeof(*workers));
+    if (!workers)
+    {
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_mutex_init(&job->cb_lock, NULL);
+    for (i = 0; i < nthreads; i++)
+    {
+        workers[i].job = job;
+        workers[i].idx = i;
+        if (pthread_create(&workers[i].thread, NULL, randWorker, &workers[i]))
+        {
+            break;
+        }
+        started++;
+    }
+    // Run inline if no thread could be created.
+    if (started == 0)
+    {
+        randWorker(&workers[0]);
+    }
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_mutex_destroy(&job->cb_lock);
+    pthread_mutex_destroy(&job->lock);
+    free(workers);
+    return job->ret;
+}
+
+static void initRandJob(zkRandJob* job,
+                        zkCTX ctx,
+                        uint64_t rdata_sz,
+                        zkRandProgressCB progress_cb,
+                        void* user_data)
+{
+    memset(job, 0, sizeof(*job));
+    job->zk_ctx = ctx;
+    job->total_sz = rdata_sz;
+    job->num_chunks = (rdata_sz + ZK_DRBG_CHUNK_SZ - 1) / ZK_DRBG_CHUNK_SZ;
+    job->fd = -1;
+    job->progress_cb = progress_cb;
+    job->user_data = user_data;
+}
+
+/*
+ *  Public API.
+ */
+
+int zkCreateRandDataFile64(zkCTX ctx,
+                           const char* dst_filename,
+                           uint64_t rdata_sz,
+                           zkRandProgressCB progress_cb,
+                           void* user_data)
+{
+    zkRandJob job;
+    int ret;
+
+    if (!dst_filename)
+    {
+        return -EINVAL;
+    }
+    if (rdata_sz < ZK_DRBG_MIN_EXPAND_SZ)
+    {
+        ret = zkCreateRandDataFile(ctx, dst_filename, (int)rdata_sz);
+        if (ret == 0 && progress_cb)
+        {
+            progress_cb(rdata_sz, rdata_sz, user_data);
+        }
+        return ret;
+    }
+
+    initRandJob(&job, ctx, rdata_sz, progress_cb, user_data);
+    job.fd = open(dst_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (job.fd < 0)
+    {
+        return -errno;
+    }
+    // Reserve the space up front so that a full disk is reported before any
+    // work is done and the out of order chunk writes do not fragment the
+    // file. Unlike posix_fallocate, fallocate does not fall back to writing
+    // every block on filesystems without native support (e.g. vfat).
+    ret = 0;
+    if (fallocate(job.fd, 0, 0, (off_t)rdata_sz) < 0 && errno != EOPNOTSUPP)
+    {
+        ret = -errno;
+    }
+
+    if (ret == 0)
+    {
+        ret = runRandJob(&job);
+    }
+    if (ret == 0 && fdatasync(job.fd) < 0)
+    {
+        ret = -errno;
+    }
+    if (close(job.fd) < 0 && ret == 0)
+    {
+        ret = -errno;
+    }
+    // Don't leave a full size file whose unwritten chunks read back as zeros.
+    if (ret < 0)
+    {
+        unlink(dst_filename);
+    }
+    return ret;
+}
+
+int zkGetRandBytes64(zkCTX ctx,
+                     uint8_t** rdata,
+                     uint64_t rdata_sz,
+                     zkRandProgressCB progress_cb,
+                     void* user_data)
+{
+    zkRandJob job;
+    int ret;
+
+    if (!rdata || rdata_sz > SIZE_MAX)
+    {
+        return -EINVAL;
+    }
+    if (rdata_sz < ZK_DRBG_MIN_EXPAND_SZ)
+    {
+        ret = zkGetRandBytes(ctx, rdata, (int)rdata_sz);
+        if (ret == 0 && progress_cb)
+        {
+            progress_cb(rdata_sz, rdata_sz, user_data);
+        }
+        return ret;
+    }
+
+    initRandJob(&job, ctx, rdata_sz, progress_cb, user_data);
+    job.mem = malloc((size_t)rdata_sz);
+    if (!job.mem)
+    {
+        return -ENOMEM;
+    }
+    ret = runRandJob(&job);
+    if (ret < 0)
+    {
+        OPENSSL_cleanse(job.mem, (size_t)rdata_sz);
+        free(job.mem);
+        return ret;
+    }
+    *rdata = job.mem;
+    return 0;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file zk_rand_drbg.h
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief C interface for high-volume random data generation.
+ * @details
+ * The random number functions in zk_app_utils.h pull every byte from the
+ * Zymkey, which limits throughput to the speed of the module interface and
+ * limits sizes to an int. The functions in this file instead use Zymkey
+ * entropy to seed a NIST SP 800-90A CTR_DRBG (AES-256, no derivation
+ * function) per CPU core. Each instance is reseeded from the Zymkey at a
+ * fixed interval, expands its output with the (hardware accelerated) AES
+ * implementation from libcrypto and, when writing to a file, streams its
+ * output with large, aligned writes.
+ *
+ * Applications using these functions must link against libcrypto and
+ * libpthread in addition to libzk_app_utils. To build a shared library,
+ * e.g. for use from Python through ctypes:
+ *
+ *     cc -shared -fPIC -O2 -o libzk_rand_drbg.so zk_rand_drbg.c \
+ *        -lzk_app_utils -lcrypto -lpthread
+ *
+ * module.py does not wrap these functions. A ctypes caller passes the
+ * context of an open Zymkey object (Zymkey._zk_ctx), declares rdata_sz as
+ * c_uint64 and frees rdata with libc's free.
+ */
+
+#ifndef __ZK_RAND_DRBG_H
+#define __ZK_RAND_DRBG_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+#include <stdint.h>
+#include "zk_app_utils.h"
+
+/**
+ * @brief Number of DRBG generate requests between reseeds from the Zymkey.
+ *        SP 800-90A allows up to 2^48; a much smaller value is used so that
+ *        fresh Zymkey entropy enters the stream every 1GB per core.
+ */
+#define ZK_DRBG_RESEED_INTERVAL     (1 << 14)
+
+/**
+ * @brief Maximum size of a single DRBG generate request (2^19 bits).
+ */
+#define ZK_DRBG_MAX_REQUEST_SZ      (1 << 16)
+
+/**
+ * @brief Size of the unit of work handed to each worker thread and of each
+ *        write to the destination file.
+ */
+#define ZK_DRBG_CHUNK_SZ            (4 << 20)
+
+/**
+ * @brief Requests smaller than this are served directly by the Zymkey.
+ */
+#define ZK_DRBG_MIN_EXPAND_SZ       (64 << 10)
+
+/**
+ * @brief Progress callback for high-volume random data generation.
+ * @param bytes_done
+ *        (input) The number of random bytes generated so far.
+ * @param bytes_total
+ *        (input) The total number of random bytes requested.
+ * @param user_data
+ *        (input) The pointer supplied by the caller of the generating
+ *        function.
+ * @note Calls may come from any of the worker threads. They are serialized
+ *       and bytes_done increases from call to call, but a count may be
+ *       skipped. The other workers keep generating while the callback runs.
+ */
+typedef void (*zkRandProgressCB)(uint64_t bytes_done,
+                                 uint64_t bytes_total,
+                                 void* user_data);
+
+/**
+ * @brief Fill a file with a large amount of random data.
+ * @details
+ *   The Zymkey provides the entropy for a set of CTR_DRBG instances (one per
+ *   online CPU), which generate the file contents in parallel. The space for
+ *   the file is reserved before any data is generated. On failure, the
+ *   destination file is removed.
+ * @param ctx
+ *        (input) Zymkey context.
+ * @param dst_filename
+ *        (input) Absolute path name for the destination file.
+ * @param rdata_sz
+ *        (input) The number of random bytes to generate.
+ * @param progress_cb
+ *        (input) Function to call each time a chunk has been written. May be
+ *        NULL.
+ * @param user_data
+ *        (input) Pointer passed through to progress_cb.
+ * @return 0 for success, less than 0 for failure.
+ */
+int zkCreateRandDataFile64(zkCTX ctx,
+                           const char* dst_filename,
+                           uint64_t rdata_sz,
+                           zkRandProgressCB progress_cb,
+                           void* user_data);
+
+/**
+ * @brief Get a large array of random bytes.
+ * @details
+ *   Same as zkCreateRandDataFile64, but the output is deposited in memory.
+ * @param ctx
+ *        (input) Zymkey context.
+ * @param rdata
+ *        (output) A pointer to a pointer to an array of unsigned bytes created
+ *        by this function. This pointer must be freed by the application when
+ *        no longer needed.
+ * @param rdata_sz
+ *        (input) The number of random bytes to generate.
+ * @param progress_cb
+ *        (input) Function to call each time a chunk has been generated. May
+ *        be NULL.
+ * @param user_data
+ *        (input) Pointer passed through to progress_cb.
+ * @return 0 for success, less than 0 for failure.
+ */
+int zkGetRandBytes64(zkCTX ctx,
+                     uint8_t** rdata,
+                     uint64_t rdata_sz,
+                     zkRandProgressCB progress_cb,
+                     void* user_data);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __ZK_RAND_DRBG_H
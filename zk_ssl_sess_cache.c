@@ -0,0 +1,373 @@
+/**
+ * @file zk_ssl_sess_cache.c
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief TLS client session resumption cache for Zymkey backed keys.
+ */
+
+// pthread_condattr_setclock, clock_gettime and strdup under -std=c99/c11.
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zk_ssl_sess_cache.h"
+
+typedef struct zkSessEntry
+{
+    struct zkSessEntry* next;
+    zkSessCache* cache;
+    char* peer;
+    SSL_SESSION* sess;              /**< TLS 1.2 session, reused */
+    SSL_SESSION* tickets[ZK_SESS_MAX_TICKETS]; /**< TLS 1.3 tickets, used once */
+    int num_tickets;
+    int pending;                    /**< handshakes expected to yield a session */
+} zkSessEntry;
+
+/* Per-connection state, stored in the SSL's ex_data. */
+typedef struct zkSessConn
+{
+    zkSessEntry* e;
+    bool pending;                   /**< counted in e->pending */
+    SSL_SESSION* offered;           /**< session set by zkSessCacheBegin */
+} zkSessConn;
+
+struct zkSessCache
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            /**< signalled when a session arrives */
+    uint32_t wait_ms;
+    zkSessEntry* entries;
+};
+
+static int zkSessExIdx = -1;
+static pthread_once_t zkSessExOnce = PTHREAD_ONCE_INIT;
+
+/* Called with the cache lock held. */
+static void zkSessConnDone(zkSessConn* c)
+{
+    if (c->pending)
+    {
+        c->pending = false;
+        c->e->pending--;
+        pthread_cond_broadcast(&c->e->cache->cond);
+    }
+}
+
+/*
+ * Called by libssl when a connection that went through zkSessCacheBegin is
+ * freed. Releases waiters if the connection never produced a session.
+ */
+static void zkSessExFree(void* parent,
+                         void* ptr,
+                         CRYPTO_EX_DATA* ad,
+                         int idx,
+                         long argl,
+                         void* argp)
+{
+    zkSessConn* c = ptr;
+
+    (void)parent;
+    (void)ad;
+    (void)idx;
+    (void)argl;
+    (void)argp;
+    if (!c)
+    {
+        return;
+    }
+    pthread_mutex_lock(&c->e->cache->lock);
+    zkSessConnDone(c);
+    pthread_mutex_unlock(&c->e->cache->lock);
+    SSL_SESSION_free(c->offered);
+    free(c);
+}
+
+static void zkSessExInit(void)
+{
+    zkSessExIdx = SSL_get_ex_new_index(0, NULL, NULL, NULL, zkSessExFree);
+}
+
+static bool zkSessUsable(const SSL_SESSION* sess)
+{
+    return sess && SSL_SESSION_is_resumable(sess) &&
+           SSL_SESSION_get_time(sess) + SSL_SESSION_get_timeout(sess) > time(NULL);
+}
+
+/* Whether two session objects are copies of the same session. */
+static bool zkSessSame(const SSL_SESSION* a, const SSL_SESSION* b)
+{
+    unsigned char ka[SSL_MAX_MASTER_KEY_LENGTH];
+    unsigned char kb[SSL_MAX_MASTER_KEY_LENGTH];
+    size_t ka_sz;
+    bool same;
+
+    if (!a || !b)
+    {
+        return false;
+    }
+    ka_sz = SSL_SESSION_get_master_key(a, ka, sizeof(ka));
+    same = ka_sz > 0 &&
+           SSL_SESSION_get_master_key(b, kb, sizeof(kb)) == ka_sz &&
+           CRYPTO_memcmp(ka, kb, ka_sz) == 0;
+    OPENSSL_cleanse(ka, sizeof(ka));
+    OPENSSL_cleanse(kb, sizeof(kb));
+    return same;
+}
+
+/* Drop expired or non-resumable sessions. Called with the cache lock held. */
+static void zkSessEvictStale(zkSessEntry* e)
+{
+    int i;
+    int n = 0;
+
+    if (e->sess && !zkSessUsable(e->sess))
+    {
+        SSL_SESSION_free(e->sess);
+        e->sess = NULL;
+    }
+    for (i = 0; i < e->num_tickets; i++)
+    {
+        if (zkSessUsable(e->tickets[i]))
+        {
+            e->tickets[n++] = e->tickets[i];
+        }
+        else
+        {
+            SSL_SESSION_free(e->tickets[i]);
+        }
+    }
+    e->num_tickets = n;
+}
+
+/*
+ * Called by libssl with each new session or TLS 1.3 ticket.
+ *
+ * The cache never shares session objects with connections: libssl marks the
+ * session of a connection that is freed without a clean shutdown as not
+ * resumable, which is exactly how connections end when the network drops.
+ */
+static int zkSessNewCB(SSL* ssl, SSL_SESSION* sess)
+{
+    zkSessConn* c = SSL_get_ex_data(ssl, zkSessExIdx);
+    zkSessEntry* e;
+    SSL_SESSION* copy;
+
+    if (!c || !(copy = SSL_SESSION_dup(sess)))
+    {
+        return 0;
+    }
+    e = c->e;
+    pthread_mutex_lock(&e->cache->lock);
+    if (SSL_SESSION_get_protocol_version(copy) >= TLS1_3_VERSION)
+    {
+        // Keep the newest tickets; the oldest expire first.
+        if (e->num_tickets == ZK_SESS_MAX_TICKETS)
+        {
+            SSL_SESSION_free(e->tickets[0]);
+            memmove(e->tickets, e->tickets + 1,
+                    (ZK_SESS_MAX_TICKETS - 1) * sizeof(e->tickets[0]));
+            e->num_tickets--;
+        }
+        e->tickets[e->num_tickets++] = copy;
+    }
+    else
+    {
+        SSL_SESSION_free(e->sess);
+        e->sess = copy;
+    }
+    zkSessConnDone(c);
+    pthread_cond_broadcast(&e->cache->cond);
+    pthread_mutex_unlock(&e->cache->lock);
+    return 0;
+}
+
+zkSessCache* zkSessCacheNew(uint32_t wait_ms)
+{
+    zkSessCache* cache;
+    pthread_condattr_t attr;
+
+    pthread_once(&zkSessExOnce, zkSessExInit);
+    if (zkSessExIdx < 0)
+    {
+        return NULL;
+    }
+    cache = calloc(1, sizeof(*cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+    cache->wait_ms = wait_ms;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cache->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return cache;
+}
+
+void zkSessCacheFree(zkSessCache* cache)
+{
+    zkSessEntry* e;
+    int i;
+
+    if (!cache)
+    {
+        return;
+    }
+    while ((e = cache->entries))
+    {
+        cache->entries = e->next;
+        SSL_SESSION_free(e->sess);
+        for (i = 0; i < e->num_tickets; i++)
+        {
+            SSL_SESSION_free(e->tickets[i]);
+        }
+        free(e->peer);
+        free(e);
+    }
+    pthread_cond_destroy(&cache->cond);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+int zkSessCacheAttach(zkSessCache* cache, SSL_CTX* ssl_ctx)
+{
+    if (!cache || !ssl_ctx)
+    {
+        return -EINVAL;
+    }
+    SSL_CTX_set_session_cache_mode(ssl_ctx,
+                                   SSL_SESS_CACHE_CLIENT |
+                                   SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, zkSessNewCB);
+    return 0;
+}
+
+int zkSessCacheBegin(zkSessCache* cache, SSL* ssl, const char* peer)
+{
+    zkSessEntry* e;
+    zkSessConn* c;
+    SSL_SESSION* offer = NULL;
+    struct timespec deadline;
+    int ret = 0;
+
+    if (!cache || !ssl || !peer || SSL_get_ex_data(ssl, zkSessExIdx))
+    {
+        return -EINVAL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += cache->wait_ms / 1000;
+    deadline.tv_nsec += (long)(cache->wait_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    for (e = cache->entries; e; e = e->next)
+    {
+        if (strcmp(e->peer, peer) == 0)
+        {
+            break;
+        }
+    }
+    if (!e)
+    {
+        e = calloc(1, sizeof(*e));
+        if (!e || !(e->peer = strdup(peer)))
+        {
+            free(e);
+            pthread_mutex_unlock(&cache->lock);
+            return -ENOMEM;
+        }
+        e->cache = cache;
+        e->next = cache->entries;
+        cache->entries = e;
+    }
+    c = calloc(1, sizeof(*c));
+    if (!c || !SSL_set_ex_data(ssl, zkSessExIdx, c))
+    {
+        free(c);
+        pthread_mutex_unlock(&cache->lock);
+        return -ENOMEM;
+    }
+    c->e = e;
+
+    for (;;)
+    {
+        zkSessEvictStale(e);
+        if (e->sess)
+        {
+            offer = SSL_SESSION_dup(e->sess);
+            break;
+        }
+        if (e->num_tickets)
+        {
+            // Each ticket is handed out once (RFC 8446 appendix C.4). The
+            // resumed handshake is expected to deliver a fresh ticket.
+            offer = e->tickets[--e->num_tickets];
+            c->pending = true;
+            e->pending++;
+            break;
+        }
+        if (e->pending == 0)
+        {
+            // Nothing in flight will produce a session: full handshake.
+            c->pending = true;
+            e->pending++;
+            break;
+        }
+        if (pthread_cond_timedwait(&cache->cond, &cache->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (offer)
+    {
+        if (!SSL_set_session(ssl, offer))
+        {
+            SSL_SESSION_free(offer);
+            return -ENOMEM;
+        }
+        // Keep a reference to recognize the session in zkSessCacheEnd.
+        c->offered = offer;
+        ret = 1;
+    }
+    return ret;
+}
+
+void zkSessCacheEnd(zkSessCache* cache, SSL* ssl, bool handshake_ok)
+{
+    zkSessConn* c = SSL_get_ex_data(ssl, zkSessExIdx);
+    zkSessEntry* e;
+
+    if (!cache || !c)
+    {
+        return;
+    }
+    e = c->e;
+    pthread_mutex_lock(&cache->lock);
+    if (!handshake_ok)
+    {
+        // Transport or other errors say nothing about the session, so keep
+        // it and let waiters proceed.
+        zkSessConnDone(c);
+    }
+    else if (c->offered && !SSL_session_reused(ssl) && zkSessSame(e->sess, c->offered))
+    {
+        // The server completed a full handshake instead of resuming.
+        SSL_SESSION_free(e->sess);
+        e->sess = NULL;
+    }
+    // On success a pending connection is released by zkSessNewCB once its
+    // session (or, for TLS 1.3, its first ticket) arrives.
+    pthread_mutex_unlock(&cache->lock);
+}
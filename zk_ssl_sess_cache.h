@@ -0,0 +1,142 @@
+/**
+ * @file zk_ssl_sess_cache.h
+ * @author Zymbit, Inc.
+ * @version 1.0
+ * @copyright Zymbit, Inc.
+ * @brief TLS client session resumption cache for Zymkey backed keys.
+ * @details
+ * When the TLS client key lives in a Zymkey (see zk_ossl_provider.c), every
+ * full handshake costs one ECDSA signature in the module. After a network
+ * outage all connections reconnect at once and queue behind each other on
+ * the module.
+ *
+ * This cache keeps sessions per peer and shares them between all
+ * connections and threads of the application, so that reconnects resume
+ * without touching the private key. A TLS 1.2 session is reused by every
+ * connection. TLS 1.3 tickets are pooled and each one is handed out only
+ * once, as RFC 8446 recommends; each resumed handshake brings a fresh ticket
+ * for the next connection.
+ *
+ * The cache also coalesces concurrent handshakes: when no session is
+ * available for a peer and none is on its way, only the first connection
+ * performs a full handshake and the others wait, up to a timeout, for the
+ * sessions that it and later resumed handshakes obtain.
+ *
+ * Call zkSessCacheBegin before opening the TCP connection. A waiting
+ * connection that already holds an idle socket can stall a single threaded
+ * server (such as openssl s_server) until the wait times out.
+ *
+ * Typical use:
+ *
+ *     zkSessCache* cache = zkSessCacheNew(5000);
+ *     zkSessCacheAttach(cache, ssl_ctx);
+ *     ...
+ *     ssl = SSL_new(ssl_ctx);
+ *     zkSessCacheBegin(cache, ssl, "a1b2c3-ats.iot.us-east-1.amazonaws.com:8883");
+ *     fd = connect_to_peer();                 // only after zkSessCacheBegin
+ *     SSL_set_fd(ssl, fd);
+ *     ok = SSL_connect(ssl) == 1;
+ *     zkSessCacheEnd(cache, ssl, ok);
+ *     ...                                     // SSL_read receives TLS 1.3 tickets
+ *
+ * Applications using these functions must link against libssl.
+ *
+ * test/ssl_sess_cache/run_storm.sh runs a reconnect storm against a local
+ * openssl s_server with a software stand-in for the Zymkey, and checks that
+ * it costs a single signature.
+ */
+
+#ifndef __ZK_SSL_SESS_CACHE_H
+#define __ZK_SSL_SESS_CACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+/**
+ * @brief Maximum number of TLS 1.3 tickets kept per peer.
+ */
+#define ZK_SESS_MAX_TICKETS         8
+
+/**
+ * @typedef Opaque session cache type.
+ */
+typedef struct zkSessCache zkSessCache;
+
+/**
+ * @brief Create a session cache.
+ * @param wait_ms
+ *        (input) The maximum amount of time, in milliseconds, that a
+ *        connection waits for another connection's full handshake to the same
+ *        peer to produce a session. If 0, handshakes are not coalesced.
+ * @return The new cache, or NULL on failure.
+ */
+zkSessCache* zkSessCacheNew(uint32_t wait_ms);
+
+/**
+ * @brief Free a session cache and all sessions held by it.
+ * @details All SSL objects that were passed to zkSessCacheBegin must have been
+ *          freed first.
+ * @param cache
+ *        (input) The cache to free.
+ */
+void zkSessCacheFree(zkSessCache* cache);
+
+/**
+ * @brief Enable client session caching on an SSL_CTX and direct new sessions
+ *        to the cache.
+ * @details This replaces any new session callback set on ssl_ctx.
+ * @param cache
+ *        (input) The session cache.
+ * @param ssl_ctx
+ *        (input) The client SSL_CTX.
+ * @return 0 for success, less than 0 for failure.
+ */
+int zkSessCacheAttach(zkSessCache* cache, SSL_CTX* ssl_ctx);
+
+/**
+ * @brief Prepare a connection for its handshake.
+ * @details If a usable session for the peer is cached, it is set on ssl. If
+ *          none is cached but other handshakes to the peer are in progress,
+ *          this function blocks until one of them produces a session or the
+ *          cache's wait timeout expires. Must be called before the TCP
+ *          connection to the peer is opened.
+ * @param cache
+ *        (input) The session cache.
+ * @param ssl
+ *        (input) The connection, before its socket is connected.
+ * @param peer
+ *        (input) A string identifying the peer, e.g. "host:port". Sessions
+ *        are only shared between connections to the same peer.
+ * @return 1 if a session was set and the handshake will attempt resumption,
+ *         0 if a full handshake will be performed, less than 0 for failure.
+ */
+int zkSessCacheBegin(zkSessCache* cache, SSL* ssl, const char* peer);
+
+/**
+ * @brief Report the outcome of a handshake started after zkSessCacheBegin.
+ * @details On failure (e.g. the network dropped), cached sessions are kept
+ *          and connections waiting on this handshake are released. If the
+ *          handshake succeeded but the server did not resume the offered
+ *          session, that session is dropped. Expired or non-resumable
+ *          sessions are dropped on lookup.
+ * @param cache
+ *        (input) The session cache.
+ * @param ssl
+ *        (input) The connection.
+ * @param handshake_ok
+ *        (input) true if SSL_connect succeeded.
+ */
+void zkSessCacheEnd(zkSessCache* cache, SSL* ssl, bool handshake_ok);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // __ZK_SSL_SESS_CACHE_H